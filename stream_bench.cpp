@@ -0,0 +1,293 @@
+// Load generator for the frame path: opens N concurrent /stream
+// connections against a running server (normally one started with
+// STREAM_SYNTHETIC=1), parses the multipart MJPEG stream, and reports
+// achieved fps, capture-to-receive latency percentiles, CPU time and
+// allocation counts. Run it via `make bench`, or standalone:
+//
+//     ./stream_bench [connections] [seconds] [host] [port] [path]
+//
+// Latency uses the X-Capture-Us header the synthetic producer stamps on
+// every part; against a real camera (no such header) only fps and
+// throughput are reported.
+
+#include <iostream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+// Allocation counter: every operator new in this process bumps it, so
+// after warmup the per-frame delta shows whether the receive path (or a
+// regression in it) allocates per frame.
+static std::atomic<uint64_t> g_allocations{0};
+
+void* operator new(size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+
+static uint64_t wallMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Per-connection results, merged after the run
+struct ConnResult {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t skipped = 0;      // X-Frame-Seq gaps: frames the server dropped for us
+    uint64_t out_of_order = 0; // X-Frame-Seq going backwards: must stay zero
+    std::vector<uint64_t> latencies_us;
+};
+
+static int connectTo(const std::string& host, int port, int recv_timeout_ms) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        close(fd);
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    struct timeval tv;
+    tv.tv_sec = recv_timeout_ms / 1000;
+    tv.tv_usec = (recv_timeout_ms % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return fd;
+}
+
+// Pulls a header value out of a CRLF-delimited block, or -1 if absent
+static long long headerValue(const std::string& block, const std::string& name) {
+    size_t pos = block.find(name + ":");
+    if (pos == std::string::npos) {
+        return -1;
+    }
+    pos += name.size() + 1;
+    while (pos < block.size() && block[pos] == ' ') {
+        pos++;
+    }
+    return atoll(block.c_str() + pos);
+}
+
+// One streaming client. Blocks (header + Content-Length body) are parsed
+// uniformly; the HTTP response header carries no Content-Length and is
+// discarded by the same rule that accepts multipart parts.
+static void clientLoop(const std::string& host, int port, const std::string& path,
+                       uint64_t deadline_us, ConnResult* result) {
+    int fd = connectTo(host, port, 200);
+    if (fd < 0) {
+        std::cerr << "❌ Connection to " << host << ":" << port << " failed" << std::endl;
+        return;
+    }
+
+    std::string request = "GET " + path + " HTTP/1.1\r\n"
+                          "Host: " + host + "\r\n"
+                          "Connection: close\r\n\r\n";
+    if (send(fd, request.c_str(), request.size(), 0) != (ssize_t)request.size()) {
+        close(fd);
+        return;
+    }
+
+    std::string buffer;
+    buffer.reserve(1 << 20);
+    result->latencies_us.reserve(1 << 14);
+    uint64_t last_seq = 0;
+    char chunk[65536];
+
+    while (wallMicros() < deadline_us) {
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n == 0) {
+            break;  // server closed
+        }
+        if (n < 0) {
+            continue;  // receive timeout: re-check the deadline
+        }
+        buffer.append(chunk, n);
+        result->bytes += n;
+
+        while (true) {
+            size_t header_end = buffer.find("\r\n\r\n");
+            if (header_end == std::string::npos) {
+                break;
+            }
+            std::string block = buffer.substr(0, header_end);
+            long long content_length = headerValue(block, "Content-Length");
+            if (content_length < 0) {
+                // The HTTP response header itself: no body to consume
+                buffer.erase(0, header_end + 4);
+                continue;
+            }
+            if (buffer.size() < header_end + 4 + (size_t)content_length) {
+                break;  // body still in flight
+            }
+
+            result->frames++;
+            long long seq = headerValue(block, "X-Frame-Seq");
+            if (seq > 0) {
+                if (last_seq != 0 && (uint64_t)seq <= last_seq) {
+                    result->out_of_order++;
+                } else if (last_seq != 0 && (uint64_t)seq > last_seq + 1) {
+                    result->skipped += seq - last_seq - 1;
+                }
+                if ((uint64_t)seq > last_seq) {
+                    last_seq = seq;
+                }
+            }
+            long long capture_us = headerValue(block, "X-Capture-Us");
+            if (capture_us > 0) {
+                uint64_t now = wallMicros();
+                if (now > (uint64_t)capture_us) {
+                    result->latencies_us.push_back(now - capture_us);
+                }
+            }
+            buffer.erase(0, header_end + 4 + content_length);
+        }
+    }
+
+    close(fd);
+}
+
+// Simple GET for the server's own /stats counters
+static std::string fetchStats(const std::string& host, int port) {
+    int fd = connectTo(host, port, 1000);
+    if (fd < 0) {
+        return "";
+    }
+    std::string request = "GET /stats HTTP/1.1\r\nHost: " + host +
+                          "\r\nConnection: close\r\n\r\n";
+    if (send(fd, request.c_str(), request.size(), 0) != (ssize_t)request.size()) {
+        close(fd);
+        return "";
+    }
+    std::string response;
+    char chunk[8192];
+    ssize_t n;
+    while ((n = recv(fd, chunk, sizeof(chunk), 0)) > 0) {
+        response.append(chunk, n);
+    }
+    close(fd);
+    size_t body = response.find("\r\n\r\n");
+    return body == std::string::npos ? "" : response.substr(body + 4);
+}
+
+static uint64_t percentile(const std::vector<uint64_t>& sorted, int pct) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t index = sorted.size() * pct / 100;
+    if (index >= sorted.size()) {
+        index = sorted.size() - 1;
+    }
+    return sorted[index];
+}
+
+int main(int argc, char* argv[]) {
+    int connections = argc > 1 ? atoi(argv[1]) : 4;
+    int seconds = argc > 2 ? atoi(argv[2]) : 10;
+    std::string host = argc > 3 ? argv[3] : "127.0.0.1";
+    int port = argc > 4 ? atoi(argv[4]) : 5000;
+    std::string path = argc > 5 ? argv[5] : "/stream";
+    if (connections < 1) connections = 1;
+    if (seconds < 1) seconds = 1;
+
+    std::cout << "🏁 Load generator: " << connections << " connection"
+              << (connections == 1 ? "" : "s") << " on " << host << ":" << port
+              << path << " for " << seconds << "s" << std::endl;
+
+    std::vector<ConnResult> results(connections);
+    uint64_t start_us = wallMicros();
+    uint64_t deadline_us = start_us + (uint64_t)seconds * 1000000;
+    uint64_t allocs_before = g_allocations.load(std::memory_order_relaxed);
+
+    std::vector<std::thread> clients;
+    for (int i = 0; i < connections; i++) {
+        clients.emplace_back(clientLoop, host, port, path, deadline_us, &results[i]);
+    }
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    double elapsed = (wallMicros() - start_us) / 1000000.0;
+    uint64_t allocs_during = g_allocations.load(std::memory_order_relaxed) - allocs_before;
+
+    uint64_t total_frames = 0;
+    uint64_t total_bytes = 0;
+    uint64_t total_skipped = 0;
+    uint64_t total_out_of_order = 0;
+    std::vector<uint64_t> latencies;
+    for (auto& result : results) {
+        total_frames += result.frames;
+        total_bytes += result.bytes;
+        total_skipped += result.skipped;
+        total_out_of_order += result.out_of_order;
+        latencies.insert(latencies.end(), result.latencies_us.begin(),
+                         result.latencies_us.end());
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpu_secs = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+    std::cout << "\n📊 Results (" << elapsed << "s elapsed):" << std::endl;
+    std::cout << "  Frames received:  " << total_frames << " ("
+              << total_frames / elapsed / connections << " fps per connection)"
+              << std::endl;
+    std::cout << "  Throughput:       " << total_bytes / elapsed / (1024.0 * 1024.0)
+              << " MB/s total" << std::endl;
+    std::cout << "  Ordering:         " << total_skipped << " skipped, "
+              << total_out_of_order << " out of order" << std::endl;
+    if (!latencies.empty()) {
+        std::cout << "  Latency (capture→receive): p50 "
+                  << percentile(latencies, 50) / 1000.0 << " ms, p90 "
+                  << percentile(latencies, 90) / 1000.0 << " ms, p99 "
+                  << percentile(latencies, 99) / 1000.0 << " ms" << std::endl;
+    } else {
+        std::cout << "  Latency:          n/a (no X-Capture-Us headers; "
+                  << "not a synthetic stream?)" << std::endl;
+    }
+    std::cout << "  Client CPU:       " << cpu_secs << "s ("
+              << cpu_secs / elapsed * 100.0 << "% of one core)" << std::endl;
+    std::cout << "  Client allocs:    " << allocs_during << " total";
+    if (total_frames > 0) {
+        std::cout << " (" << (double)allocs_during / total_frames << " per frame)";
+    }
+    std::cout << std::endl;
+
+    std::string stats = fetchStats(host, port);
+    if (!stats.empty()) {
+        std::cout << "\n📈 Server /stats:\n" << stats << std::endl;
+    }
+
+    return total_frames > 0 ? 0 : 1;
+}